@@ -0,0 +1,33 @@
+/* File: arena.h */
+
+#ifndef ARENA
+#define ARENA
+#include <stddef.h>
+
+/* Block of memory in an arena, followed by its data */
+typedef struct arena_block_t {
+    struct arena_block_t *next; // previously filled block
+    size_t size;                // bytes of data in the block
+    size_t used;                // bytes of data already handed out
+} arena_block_t;
+
+/* Arena allocator: memory is handed out from large blocks and is all freed at once */
+typedef struct {
+    arena_block_t *head;        // block currently being filled
+} arena_t;
+
+/* Initialises an empty arena */
+void arena_init(arena_t &arena);
+
+/* Allocates size bytes from the arena, suitably aligned for any type.
+   Returns NULL if memory couldn't be allocated. */
+void *arena_alloc(arena_t &arena, size_t size);
+
+/* Copies the nul-terminated str into the arena.
+   Returns NULL if memory couldn't be allocated. */
+char *arena_strdup(arena_t &arena, const char *str);
+
+/* Frees all memory allocated from the arena */
+void arena_free(arena_t &arena);
+
+#endif
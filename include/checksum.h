@@ -0,0 +1,35 @@
+/* File: checksum.h */
+
+#ifndef CHECKSUM
+#define CHECKSUM
+#include <stdint.h>
+#include <stddef.h>
+
+/* Byte starting a request that carries options: it is followed by the options byte and then the requested path.
+   Requests without options are just the path, as before, so older clients keep working */
+#define OPTIONS_MARKER '\x01'
+
+/* Bit of the options byte, asking the server for checksums */
+#define OPTION_CHECKSUMS 0x01
+
+/* Updates the CRC32C (Castagnoli) checksum crc with count bytes from buf and returns the new checksum.
+   Start with crc = 0. Uses the SSE4.2 crc32 instruction when the processor supports it, a table otherwise. */
+uint32_t crc32c(uint32_t crc, const char *buf, size_t count);
+
+/* Precomputed appending of a fixed number of bytes to a checksum, making crc32c_combine a few table lookups */
+typedef struct {
+    uint32_t table[4][256];     // result of appending count bytes for each byte of the checksum
+    size_t count;               // number of bytes appended
+} crc32c_shift_t;
+
+/* Prepares shift for crc32c_combine with blocks of count bytes */
+void crc32c_shift_init(crc32c_shift_t &shift, size_t count);
+
+/* Returns the checksum of two pieces of data from the checksum crc1 of the first piece
+   and the checksum crc2 of the second one, which is count2 bytes long */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t count2);
+
+/* Same as above for a second piece of shift.count bytes, with a few table lookups */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, const crc32c_shift_t &shift);
+
+#endif
@@ -10,4 +10,9 @@ void closedir_report(DIR *dir);
 /* Writes count bytes from buf to fd.
    Doesn't return until either count bytes are written or there's an error.
    Returns 0 in case of success and -1 in case of failure. */
-int safe_write_bytes(int fd, const char *buf, size_t count);
\ No newline at end of file
+int safe_write_bytes(int fd, const char *buf, size_t count);
+
+/* Reads count bytes from fd to buf.
+   Doesn't return until either count bytes are read, end of file is reached or there's an error.
+   Returns the number of bytes read in case of success and -1 in case of failure. */
+int safe_read_bytes(int fd, char *buf, size_t count);
\ No newline at end of file
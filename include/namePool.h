@@ -0,0 +1,20 @@
+/* File: namePool.h */
+
+#ifndef NAME_POOL
+#define NAME_POOL
+#include <stddef.h>
+
+#define NAME_SLOT_SIZE 64   // bytes of a slot, enough for most file names and their nul (longer names get their own memory)
+
+/* Creates the pool of slots for the names of queued files, with at most count slots (made when first needed).
+   Returns 0 in case of success and -1 in case of failure. */
+int name_pool_init(size_t count);
+
+/* Copies the nul-terminated name to a slot of the pool, waiting until one is free.
+   Returns the copy, or NULL if memory couldn't be allocated. */
+char *name_pool_copy(const char *name);
+
+/* Gives back a copy made with name_pool_copy */
+void name_pool_release(char *copy);
+
+#endif
@@ -0,0 +1,64 @@
+/* File: serverIndex.h */
+
+#ifndef SERVER_INDEX
+#define SERVER_INDEX
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC "TREEIDX"   // first bytes of an index file
+#define INDEX_VERSION 1         // version of the index file layout
+
+/* Types of index entries */
+#define INDEX_FILE 1
+#define INDEX_DIR 2
+
+/* Header at the start of an index file, followed by node_count entries and then names_size bytes of names */
+typedef struct {
+    char magic[8];          // INDEX_MAGIC
+    uint32_t version;       // INDEX_VERSION
+    uint32_t node_count;    // number of entries
+    uint64_t names_size;    // bytes of nul-terminated names after the entries
+} index_header_t;
+
+/* Entry of an index file. Entries are in depth-first preorder, so the subtree of a directory directly follows it,
+   and the first entry is the indexed directory itself, named by its absolute path */
+typedef struct {
+    uint64_t size;          // size of the file in bytes
+    int64_t mtime;          // modification time in nanoseconds
+    uint64_t name_offset;   // offset of the name in the names
+    uint32_t subtree_size;  // number of entries in the subtree, including this one
+    uint32_t type;          // INDEX_FILE or INDEX_DIR
+} index_node_t;
+
+/* Memory-mapped index file */
+typedef struct {
+    void *map;                  // start of the mapping
+    size_t map_size;            // size of the mapping
+    const index_node_t *nodes;  // entries of the index
+    uint32_t node_count;        // number of entries
+    const char *names;          // names of the entries
+    uint64_t names_size;        // bytes of names
+    int refs;                   // number of threads using the index, plus one while it is the current one (guarded by the index lock)
+} tree_index_t;
+
+/* Loads the index of the directory tree in root from index_path, building it if it doesn't exist or is for another directory.
+   Returns 0 in case of success and -1 in case of failure. */
+int index_init(const char *index_path, const char *root);
+
+/* Returns the current index, which must be given back with index_release, or NULL if there is none */
+tree_index_t *index_acquire();
+
+/* Gives back an index returned by index_acquire */
+void index_release(tree_index_t *index);
+
+/* Modification time of a file in nanoseconds, as kept in the index */
+int64_t stat_mtime(const struct stat &stat_buf);
+
+/* Returns the position in index of the directory in path, or -1 if it isn't in the index */
+int64_t index_find(const tree_index_t *index, const char *path);
+
+/* Function to be executed by the index refresh thread, rebuilding the index every (intptr_t) void_t_interval seconds */
+void *index_refresh_thread(void *void_t_interval);
+
+#endif
@@ -0,0 +1,4 @@
+/* File: serverListener.h */
+
+/* Function to be executed by listener threads, accepting connections on the listening socket in void_t_socket and creating a communication thread for each */
+void *listener_thread(void *void_t_socket);
@@ -2,22 +2,34 @@
 
 #ifndef SERVER_TYPES
 #define SERVER_TYPES
-#include <string>
+#include <stdint.h>
+#include <pthread.h>
 
-/* Struct holding everything a worker thread needs to know about a socket */
+/* Struct holding everything a worker thread needs to know about a socket.
+   It lives in the communication thread serving the socket, which outlives all of the socket's tasks */
 typedef struct {
     int sock_id;                            // id of the socket
-    pthread_mutex_t *lock_data_transfer;    // mutex guarding data transfer to the socket
-    pthread_mutex_t *lock_tasks_remaining;  // mutex guarding access to tasks_remaining
-    int *tasks_remaining;                   // number of tasks still remaining on the socket
+    pthread_mutex_t lock_data_transfer;     // mutex guarding data transfer to the socket
+    pthread_mutex_t lock_tasks_remaining;   // mutex guarding access to tasks_remaining
+    pthread_cond_t cond_done;               // condition variable to wait for/signal when a task on the socket is completed
+    int tasks_remaining;                    // number of tasks still remaining on the socket
+    int relative_path_size;                 // length of the relative part to the requested folder, not including the folder itself
+    char checksums;                         // whether the client asked for CRC32C checksums of the transfered data
 } sock_info_t;
 
+/* Node of the tree of directories being transfered, so that tasks share the path prefixes of their files */
+typedef struct dir_node_t {
+    struct dir_node_t *parent;  // directory containing this one, NULL for the requested folder
+    const char *name;           // name of the directory (the whole requested path for the requested folder)
+} dir_node_t;
+
 /* Struct specifying a file transfer task in the queue */
 typedef struct {
-    int relative_path_size; // Length of the relative part to the requested folder, not including the folder itself
-    std::string path;       // The path to the folder
-    uint32_t file_size;     // The size of the file to be transfered
-    sock_info_t sock_info;  // Information about the socket to which the file should be transfered
+    dir_node_t *dir;            // The directory containing the file
+    const char *name;           // The name of the file inside dir
+    uint32_t file_size;         // The size of the file when the task was made (the worker sends the size it finds when opening it)
+    char pooled_name;           // Whether name is a copy in the name pool, given back when the task is finished
+    sock_info_t *sock_info;     // Information about the socket to which the file should be transfered
 } task;
 
-#endif
\ No newline at end of file
+#endif
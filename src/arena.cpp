@@ -0,0 +1,59 @@
+/* File: arena.cpp */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE 65536          // default number of data bytes in an arena block
+#define ARENA_ALIGNMENT sizeof(void *)  // alignment of every allocation
+
+/* Initialises an empty arena */
+void arena_init(arena_t &arena) {
+    arena.head = NULL;
+}
+
+/* Allocates size bytes from the arena, suitably aligned for any type.
+   Returns NULL if memory couldn't be allocated. */
+void *arena_alloc(arena_t &arena, size_t size) {
+    /* Round up so that the next allocation stays aligned */
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    /* If the current block is full, start a new one (a bigger one if needed) */
+    if ((arena.head == NULL) || (arena.head->size - arena.head->used < size)) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        arena_block_t *block;
+        if ((block = (arena_block_t *) malloc(sizeof(arena_block_t) + block_size)) == NULL) {
+            return NULL;
+        }
+        block->next = arena.head;
+        block->size = block_size;
+        block->used = 0;
+        arena.head = block;
+    }
+
+    /* Hand out the next size bytes of the block */
+    void *ptr = (char *) (arena.head + 1) + arena.head->used;
+    arena.head->used += size;
+    return ptr;
+}
+
+/* Copies the nul-terminated str into the arena.
+   Returns NULL if memory couldn't be allocated. */
+char *arena_strdup(arena_t &arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy;
+    if ((copy = (char *) arena_alloc(arena, len)) == NULL) {
+        return NULL;
+    }
+    memcpy(copy, str, len);
+    return copy;
+}
+
+/* Frees all memory allocated from the arena */
+void arena_free(arena_t &arena) {
+    while (arena.head != NULL) {
+        arena_block_t *next = arena.head->next;
+        free(arena.head);
+        arena.head = next;
+    }
+}
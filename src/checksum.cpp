@@ -0,0 +1,188 @@
+/* File: checksum.cpp */
+
+#include <string.h>
+#include <pthread.h>
+#include "checksum.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+#define CRC32C_POLY 0x82F63B78  // reflected Castagnoli polynomial
+
+/* Lookup tables for the software implementation, processing 8 bytes per step ("slicing-by-8") */
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+/* Fills crc_table */
+static void crc32c_init_table(void) {
+    for (uint32_t i = 0 ; i < 256 ; i++) {
+        uint32_t crc = i;
+        for (int j = 0 ; j < 8 ; j++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc_table[0][i] = crc;
+    }
+    for (uint32_t i = 0 ; i < 256 ; i++) {
+        for (int j = 1 ; j < 8 ; j++) {
+            crc_table[j][i] = (crc_table[j - 1][i] >> 8) ^ crc_table[0][crc_table[j - 1][i] & 0xFF];
+        }
+    }
+}
+
+/* Software CRC32C on the raw (non-inverted) register */
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *buf, size_t count) {
+    pthread_once(&crc_table_once, crc32c_init_table);
+    /* Byte at a time until buf is aligned */
+    while (count && ((uintptr_t) buf & 7)) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *buf++) & 0xFF];
+        count--;
+    }
+    /* 8 bytes at a time (assumes a little-endian host) */
+    while (count >= 8) {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        word ^= crc;
+        crc = crc_table[7][word & 0xFF] ^ crc_table[6][(word >> 8) & 0xFF] ^
+              crc_table[5][(word >> 16) & 0xFF] ^ crc_table[4][(word >> 24) & 0xFF] ^
+              crc_table[3][(word >> 32) & 0xFF] ^ crc_table[2][(word >> 40) & 0xFF] ^
+              crc_table[1][(word >> 48) & 0xFF] ^ crc_table[0][word >> 56];
+        buf += 8;
+        count -= 8;
+    }
+    /* Leftover bytes */
+    while (count--) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *buf++) & 0xFF];
+    }
+    return crc;
+}
+
+/* Multiplies a and b modulo the polynomial, both in the reflected representation of the register (x^0 in the top bit) */
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t m = (uint32_t) 1 << 31 ; m != 0 ; m >>= 1) {
+        if (a & m) {
+            product ^= b;
+        }
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+/* Returns x^(8 * count) modulo the polynomial, the factor that appends count bytes to a checksum */
+static uint32_t crc32c_append_factor(size_t count) {
+    uint32_t factor = (uint32_t) 1 << 31;   // x^0
+    uint32_t power = (uint32_t) 1 << 23;    // x^8
+    while (count) {
+        if (count & 1) {
+            factor = crc32c_multiply(power, factor);
+        }
+        power = crc32c_multiply(power, power);
+        count >>= 1;
+    }
+    return factor;
+}
+
+/* Prepares shift for crc32c_combine with blocks of count bytes */
+void crc32c_shift_init(crc32c_shift_t &shift, size_t count) {
+    /* Appending is linear in the checksum, so it is the xor of the results for each of its bytes */
+    uint32_t factor = crc32c_append_factor(count);
+    for (int k = 0 ; k < 4 ; k++) {
+        for (uint32_t i = 0 ; i < 256 ; i++) {
+            shift.table[k][i] = crc32c_multiply(factor, i << (8 * k));
+        }
+    }
+    shift.count = count;
+}
+
+/* Returns the checksum of two pieces of data from the checksum crc1 of the first piece
+   and the checksum crc2 of the second one, which is count2 bytes long */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t count2) {
+    return crc32c_multiply(crc32c_append_factor(count2), crc1) ^ crc2;
+}
+
+/* Same as above for a second piece of shift.count bytes, with a few table lookups */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, const crc32c_shift_t &shift) {
+    return shift.table[0][crc1 & 0xFF] ^ shift.table[1][(crc1 >> 8) & 0xFF] ^
+           shift.table[2][(crc1 >> 16) & 0xFF] ^ shift.table[3][crc1 >> 24] ^ crc2;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#ifdef __x86_64__
+#define CRC32C_LANE 128     // bytes of each of the lanes the hardware implementation goes through together
+
+/* Appending of a lane to a checksum */
+static crc32c_shift_t lane_shift;
+static pthread_once_t lane_shift_once = PTHREAD_ONCE_INIT;
+
+/* Fills lane_shift */
+static void crc32c_init_lane_shift(void) {
+    crc32c_shift_init(lane_shift, CRC32C_LANE);
+}
+#endif
+
+/* Hardware CRC32C on the raw (non-inverted) register, using the SSE4.2 crc32 instruction */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *buf, size_t count) {
+    /* Byte at a time until buf is aligned */
+    while (count && ((uintptr_t) buf & 7)) {
+        crc = _mm_crc32_u8(crc, *buf++);
+        count--;
+    }
+#ifdef __x86_64__
+    /* Three independent lanes at a time, since each crc32 instruction has to wait for the previous one on the same lane
+       but not for the ones on the other lanes. The lanes are then joined like consecutive pieces (crc32c_combine) */
+    pthread_once(&lane_shift_once, crc32c_init_lane_shift);
+    while (count >= 3 * CRC32C_LANE) {
+        uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+        for (size_t i = 0 ; i < CRC32C_LANE ; i += 8) {
+            uint64_t word0, word1, word2;
+            memcpy(&word0, buf + i, 8);
+            memcpy(&word1, buf + CRC32C_LANE + i, 8);
+            memcpy(&word2, buf + 2 * CRC32C_LANE + i, 8);
+            crc0 = _mm_crc32_u64(crc0, word0);
+            crc1 = _mm_crc32_u64(crc1, word1);
+            crc2 = _mm_crc32_u64(crc2, word2);
+        }
+        crc = crc32c_combine(crc32c_combine((uint32_t) crc0, (uint32_t) crc1, lane_shift), (uint32_t) crc2, lane_shift);
+        buf += 3 * CRC32C_LANE;
+        count -= 3 * CRC32C_LANE;
+    }
+
+    /* 8 bytes at a time */
+    uint64_t crc64 = crc;
+    while (count >= 8) {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        buf += 8;
+        count -= 8;
+    }
+    crc = (uint32_t) crc64;
+#endif
+    /* 4 bytes at a time */
+    while (count >= 4) {
+        uint32_t word;
+        memcpy(&word, buf, 4);
+        crc = _mm_crc32_u32(crc, word);
+        buf += 4;
+        count -= 4;
+    }
+    /* Leftover bytes */
+    while (count--) {
+        crc = _mm_crc32_u8(crc, *buf++);
+    }
+    return crc;
+}
+#endif
+
+/* Updates the CRC32C (Castagnoli) checksum crc with count bytes from buf and returns the new checksum.
+   Start with crc = 0. Uses the SSE4.2 crc32 instruction when the processor supports it, a table otherwise. */
+uint32_t crc32c(uint32_t crc, const char *buf, size_t count) {
+    crc = ~crc;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return ~crc32c_hw(crc, (const unsigned char *) buf, count);
+    }
+#endif
+    return ~crc32c_sw(crc, (const unsigned char *) buf, count);
+}
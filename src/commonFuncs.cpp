@@ -30,12 +30,36 @@ void closedir_report(DIR *dir) {
    Returns 0 in case of success and -1 in case of failure. */
 int safe_write_bytes(int fd, const char *buf, size_t count) {
     int written;
-    while ((written = write(fd, buf, count)) < count) {
-        if ((written < 0) && (errno != EINTR)) {
-            return -1;
+    while ((written = write(fd, buf, count)) < (int) count) {
+        if (written < 0) {
+            if (errno != EINTR) {
+                return -1;
+            }
+            continue;
         }
-        buf += count;
+        buf += written;
         count -= written;
     }
     return 0;
+}
+
+/* Reads count bytes from fd to buf.
+   Doesn't return until either count bytes are read, end of file is reached or there's an error.
+   Returns the number of bytes read in case of success and -1 in case of failure. */
+int safe_read_bytes(int fd, char *buf, size_t count) {
+    size_t total = 0;
+    int nread;
+    while (total < count) {
+        if ((nread = read(fd, buf + total, count - total)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (nread == 0) {
+            break;
+        }
+        total += nread;
+    }
+    return total;
 }
\ No newline at end of file
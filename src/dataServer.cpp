@@ -1,5 +1,8 @@
 /* File: dataServer.cpp */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <cstring>
 #include <queue>
 #include <netdb.h>
@@ -8,12 +11,19 @@
 #include "serverTypes.h"
 #include "serverCommunication.h"
 #include "serverWorker.h"
+#include "serverListener.h"
+#include "serverIndex.h"
+#include "checksum.h"
+#include "namePool.h"
 
 /* Global variables that need to be visible to other threads */
 
 /* Command line arguments */
 int block_size, queue_size;
 
+/* Appending of a block to a checksum, for the checksums of whole files */
+crc32c_shift_t block_shift;
+
 /* Queue containing all current tasks */
 std::queue<task> *tasks;
 
@@ -21,7 +31,6 @@ std::queue<task> *tasks;
 pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;     // Mutex guarding access to the tasks queue
 pthread_cond_t cond_nonempty = PTHREAD_COND_INITIALIZER;    // Condition variable to wait for/signal a non-empty tasks queue
 pthread_cond_t cond_nonfull = PTHREAD_COND_INITIALIZER;     // Condition variable to wait for/signal a non-full tasks queue
-pthread_cond_t cond_done = PTHREAD_COND_INITIALIZER;        // Condition variable to wait for/signal when a task is completed
 
 int main(int argc, char* argv[]) {
     /* Ignore SIGPIPE (socket errors handled explicitly in threads) */
@@ -31,13 +40,20 @@ int main(int argc, char* argv[]) {
     sigfillset(&(act.sa_mask));
     sigaction(SIGPIPE, &act, NULL);
 
-	/* Initialising parameters */
-    if (argc != 9) {
+	/* Initialising parameters (-l, -k, -x, -r and -u are optional) */
+    if ((argc < 9) || (argc % 2 == 0)) {
         fprintf(stderr, "Invalid number of arguments\n");
         exit(EXIT_FAILURE);
     }
-    int port, thread_pool_size;
-	for (int i = 1 ; i < 9 ; i += 2) { 
+    int port = -1, thread_pool_size = -1;  // -1 until given, like queue_size and block_size
+    queue_size = -1;
+    block_size = -1;
+    int listener_count = 1; // number of listening sockets sharing the port, each with its own thread accepting connections
+    int backlog = 5;        // maximum length of the queue of pending connections of each listening socket
+    char *index_path = NULL;    // file keeping the index of index_root, if any
+    char *index_root = NULL;    // directory whose tree is indexed
+    int index_interval = 0;     // seconds between refreshes of the index (0 for never)
+	for (int i = 1 ; i < argc ; i += 2) { 
 		if (!strcmp(argv[i], "-p")) {
 			port = atoi(argv[i + 1]);
 		}
@@ -50,14 +66,62 @@ int main(int argc, char* argv[]) {
         else if (!strcmp(argv[i], "-b")) {
 			block_size = atoi(argv[i + 1]);
         }
+        else if (!strcmp(argv[i], "-l")) {
+			listener_count = atoi(argv[i + 1]);
+        }
+        else if (!strcmp(argv[i], "-k")) {
+			backlog = atoi(argv[i + 1]);
+        }
+        else if (!strcmp(argv[i], "-x")) {
+			index_path = argv[i + 1];
+        }
+        else if (!strcmp(argv[i], "-r")) {
+			index_root = argv[i + 1];
+        }
+        else if (!strcmp(argv[i], "-u")) {
+			index_interval = atoi(argv[i + 1]);
+        }
         else {
             fprintf(stderr, "Invalid passing of arguments\n");
             exit(EXIT_FAILURE);
         }
 	}
+    /* -p, -s, -q and -b are required */
+    if ((port == -1) || (thread_pool_size == -1) || (queue_size == -1) || (block_size == -1)) {
+        fprintf(stderr, "Invalid passing of arguments\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((port < 1) || (port > 65535)) {
+        fprintf(stderr, "Invalid port\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((thread_pool_size < 1) || (queue_size < 1) || (block_size < 1)) {
+        fprintf(stderr, "Thread pool, queue and block sizes should be positive\n");
+        exit(EXIT_FAILURE);
+    }
+    if (listener_count < 1) {
+        fprintf(stderr, "Invalid number of listeners\n");
+        exit(EXIT_FAILURE);
+    }
+    if (backlog < 1) {
+        fprintf(stderr, "Invalid backlog\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((index_path == NULL) != (index_root == NULL)) {
+        fprintf(stderr, "An index needs both a file (-x) and a directory (-r)\n");
+        exit(EXIT_FAILURE);
+    }
     
-    /* Create task queue */
+    crc32c_shift_init(block_shift, block_size);
+
+    /* Create task queue, and the pool of slots for the names of the files in it: one for each place in the queue
+       and one for each worker, so that making a task only waits for a slot while the queue and the workers are busy */
     tasks = new std::queue<task>;
+    if (name_pool_init(queue_size + thread_pool_size) != 0) {
+        perror("dataServer: malloc");
+        delete tasks;
+        exit(EXIT_FAILURE);
+    }
 
     /* Create worker threads */
     pthread_t worker_thread_id;
@@ -72,68 +136,88 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    /* Create socket */
-    int sock;
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        perror("dataServer: create socket");
-        delete tasks;
-        exit(EXIT_FAILURE);
-    }
-    
-    /* Bind socket to address */
-    struct sockaddr_in server;
-    server.sin_family = AF_INET;    /* Internet domain */
-    server.sin_addr.s_addr = htonl(INADDR_ANY);
-    server.sin_port = htons(port);  /* The given port */
-    if (bind(sock, (sockaddr*) &server, sizeof(server)) < 0) {
-        perror("dataServer: bind socket");
-        delete tasks;
-        close_report(sock);
-        exit(EXIT_FAILURE);
-    }
-
-    /* Listen for connections */
-    if (listen(sock, 5) < 0) {
-        perror("dataServer: socket listen");
-        delete tasks;
-        close_report(sock);
-        exit(EXIT_FAILURE);
+    /* Load the index of the exported tree and keep it up to date */
+    if (index_path != NULL) {
+        if (index_init(index_path, index_root) != 0) {
+            fprintf(stderr, "dataServer: couldn't load index\n");
+            delete tasks;
+            exit(EXIT_FAILURE);
+        }
+        if (index_interval > 0) {
+            pthread_t index_thread_id;
+            if (pthread_create(&index_thread_id, NULL, index_refresh_thread, (void *) (intptr_t) index_interval) != 0) {
+                perror("dataServer: create index thread");
+                exit(EXIT_FAILURE);
+            }
+            if (pthread_detach(index_thread_id) != 0) {
+                perror("dataServer: detach index thread");
+                exit(EXIT_FAILURE);
+            }
+        }
     }
-    printf("Server was successfully initialized...\n");
-    printf("Listening for connections to port %d\n", port);
 
-    /* Main server loop */
-    while (1) {
-        int *newsock;
-        struct sockaddr_in client;
-        socklen_t clientlen = sizeof(client);
-        if ((newsock = (int *) malloc(sizeof(int))) == NULL) {
-            perror("dataServer: malloc");
+    /* Create the listening sockets, sharing the port through SO_REUSEPORT so that the kernel spreads connections among them */
+    int *listeners = new int[listener_count];
+    for (int i = 0 ; i < listener_count ; i++) {
+        /* Create socket */
+        int sock;
+        if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+            perror("dataServer: create socket");
+            delete tasks;
+            exit(EXIT_FAILURE);
+        }
+        if (listener_count > 1) {
+            int enable = 1;
+            if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+                perror("dataServer: set socket option");
+                delete tasks;
+                close_report(sock);
+                exit(EXIT_FAILURE);
+            }
+        }
+        
+        /* Bind socket to address */
+        struct sockaddr_in server;
+        server.sin_family = AF_INET;    /* Internet domain */
+        server.sin_addr.s_addr = htonl(INADDR_ANY);
+        server.sin_port = htons(port);  /* The given port */
+        if (bind(sock, (sockaddr*) &server, sizeof(server)) < 0) {
+            perror("dataServer: bind socket");
             delete tasks;
             close_report(sock);
             exit(EXIT_FAILURE);
         }
-        /* Accept connection */
-        if ((*newsock = accept(sock, (sockaddr*) &client, &clientlen)) < 0) {
-            perror("dataServer: accept connection");
+
+        /* Listen for connections */
+        if (listen(sock, backlog) < 0) {
+            perror("dataServer: socket listen");
             delete tasks;
             close_report(sock);
             exit(EXIT_FAILURE);
         }
-        /* Create communication thread for this client */
-        pthread_t com_thread_id;
-        if (pthread_create(&com_thread_id, NULL, communication_thread, (void *) newsock) != 0) {
-            perror("dataServer: create communication thread");
+        listeners[i] = sock;
+    }
+    printf("Server was successfully initialized...\n");
+    printf("Listening for connections to port %d\n", port);
+
+    /* Create a listener thread for every listening socket but the first */
+    pthread_t listener_thread_id;
+    for (int i = 1 ; i < listener_count ; i++) {
+        if (pthread_create(&listener_thread_id, NULL, listener_thread, (void *) (intptr_t) listeners[i]) != 0) {
+            perror("dataServer: create listener thread");
             exit(EXIT_FAILURE);
         }
-        if (pthread_detach(com_thread_id) != 0) {
-            perror("dataServer: detach communication thread");
+        if (pthread_detach(listener_thread_id) != 0) {
+            perror("dataServer: detach listener thread");
             exit(EXIT_FAILURE);
         }
     }
 
+    /* Main server loop, on the first listening socket */
+    listener_thread((void *) (intptr_t) listeners[0]);
+
     /* Exiting successfully (assuming it never happens) */
     delete tasks;
-    close_report(sock);
+    delete[] listeners;
     exit(EXIT_SUCCESS);
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+/* File: namePool.cpp */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "namePool.h"
+
+/* Slots of the pool, made when first needed, and the ones currently free */
+static size_t slot_limit = 0;       // maximum number of slots
+static size_t slot_count = 0;       // number of slots made so far
+static char **free_slots = NULL;    // stack of free slots
+static size_t free_count = 0;       // number of free slots
+
+/* Variables for synchronisation */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;   // Mutex guarding the slots
+static pthread_cond_t cond_free = PTHREAD_COND_INITIALIZER;     // Condition variable to wait for/signal a free slot
+
+/* Creates the pool of slots for the names of queued files, with at most count slots (made when first needed).
+   Returns 0 in case of success and -1 in case of failure. */
+int name_pool_init(size_t count) {
+    if ((free_slots = (char **) malloc(count * sizeof(char *))) == NULL) {
+        return -1;
+    }
+    slot_limit = count;
+    return 0;
+}
+
+/* Copies the nul-terminated name to a slot of the pool, waiting until one is free.
+   Returns the copy, or NULL if memory couldn't be allocated. */
+char *name_pool_copy(const char *name) {
+    size_t size = strlen(name) + 1;
+    char *copy;
+
+    /* Names that don't fit in a slot are rare, so they get their own memory */
+    if (size > NAME_SLOT_SIZE) {
+        if ((copy = (char *) malloc(size)) != NULL) {
+            memcpy(copy, name, size);
+        }
+        return copy;
+    }
+
+    /* Make a new slot if none is free and the limit allows it, else wait for one to be given back */
+    pthread_mutex_lock(&pool_lock);
+    if ((free_count == 0) && (slot_count < slot_limit)) {
+        if ((copy = (char *) malloc(NAME_SLOT_SIZE)) != NULL) {
+            slot_count++;
+        }
+    }
+    else {
+        while (free_count == 0) {
+            pthread_cond_wait(&cond_free, &pool_lock);
+        }
+        copy = free_slots[--free_count];
+    }
+    pthread_mutex_unlock(&pool_lock);
+    if (copy != NULL) {
+        memcpy(copy, name, size);
+    }
+    return copy;
+}
+
+/* Gives back a copy made with name_pool_copy */
+void name_pool_release(char *copy) {
+    if (strlen(copy) + 1 > NAME_SLOT_SIZE) {
+        free(copy);
+        return;
+    }
+    pthread_mutex_lock(&pool_lock);
+    free_slots[free_count++] = copy;
+    pthread_mutex_unlock(&pool_lock);
+    pthread_cond_signal(&cond_free);
+}
@@ -13,21 +13,41 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include "commonFuncs.h"
+#include "checksum.h"
 
 #define OUTPUT "./output/"
 
+/* States of the incoming data after the file size (states 0 to sizeof(uint32_t) read the file name and size) */
+#define STATE_DATA (sizeof(uint32_t) + 1)   // reading file contents
+#define STATE_BLOCK_CRC (STATE_DATA + 1)    // reading the checksum of the last block
+#define STATE_FILE_CRC (STATE_DATA + 2)     // reading the checksum of the whole file
+#define STATE_BLOCK_SIZE (STATE_DATA + 3)   // reading the server's block size
+
+#define READ_SIZE 50                // bytes read from the socket at a time
+#define READ_SIZE_CHECKSUMS 65536   // bytes read from the socket at a time with checksums, so that blocks aren't split in many small pieces
+
 int main(int argc, char* argv[]) {
 
 	/* Initialising parameters */
-    if (argc != 7) {
+    if ((argc != 7) && (argc != 8)) {
         fprintf(stderr, "Invalid number of arguments\n");
         exit(EXIT_FAILURE);
     }
     in_addr_t server_ip;
     in_port_t server_port;
     char *directory, *server_ip_name;
-	for (int i = 1 ; i < 7 ; i += 2) { 
-		if (!strcmp(argv[i], "-i")) {
+    char options = 0;
+	for (int i = 1 ; i < argc ; i += 2) { 
+        /* Optional flag without a value, asking for checksums */
+        if (!strcmp(argv[i], "-c")) {
+            options |= OPTION_CHECKSUMS;
+            i--;
+        }
+		else if (i + 1 == argc) {
+            fprintf(stderr, "Invalid passing of arguments\n");
+            exit(EXIT_FAILURE);
+        }
+		else if (!strcmp(argv[i], "-i")) {
             server_ip_name = argv[i + 1];
 			inet_pton(AF_INET, server_ip_name, &server_ip);
 		}
@@ -66,8 +86,13 @@ int main(int argc, char* argv[]) {
 
     /* Communicate with server */
 
-    /* Send the desired path */
-    std::string request = directory;
+    /* Send the desired path, preceded by the options if there are any */
+    std::string request;
+    if (options) {
+        request.push_back(OPTIONS_MARKER);
+        request.push_back(options);
+    }
+    request.append(directory);
     request.push_back('\0');
     if (safe_write_bytes(sock, request.data(), request.size()) < 0) {
         perror("remoteClient: write to socket");
@@ -77,7 +102,7 @@ int main(int argc, char* argv[]) {
 
     /* Process the results */
     int nread;
-    char buf[50];
+    char buf[READ_SIZE_CHECKSUMS];
     int fd;                     // file descriptor of the newly copied file
     std::string file_name;      // name (path) of the file sent by the server
     uint32_t file_size = 0;     // size of the file sent by the server in bytes
@@ -85,7 +110,20 @@ int main(int argc, char* argv[]) {
     int to_write;               // bytes remaiining to write to the file
     char state = 0;             // specifying how the current bytes read should be interpreted
     char done = 0;              // whether all transfer is complete
-    while (((nread = read(sock, buf, 50)) > 0) || (errno == EINTR)) {
+    char checksums = options & OPTION_CHECKSUMS;    // whether each block and file is followed by its checksum
+    uint32_t block_size = 0;    // size of the blocks the server sends, each followed by its checksum
+    uint32_t block_length;      // bytes in the current block
+    uint32_t block_remaining;   // bytes remaining in the current block
+    crc32c_shift_t block_shift; // appending of a whole block to a checksum
+    uint32_t block_crc = 0;     // checksum of the current block as received so far
+    uint32_t file_crc = 0;      // checksum of the blocks of the current file received so far
+    int read_size = READ_SIZE;
+    /* If checksums were asked for, the server sends its block size first */
+    if (checksums) {
+        state = STATE_BLOCK_SIZE;
+        read_size = READ_SIZE_CHECKSUMS;
+    }
+    while (((nread = read(sock, buf, read_size)) > 0) || (errno == EINTR)) {
         /* After reading a block from the socket, process it in memory */
         for (int i = 0 ; i < nread ; i++) {
             /* If reading the filename */
@@ -109,11 +147,11 @@ int main(int argc, char* argv[]) {
                 }
             }
             /* If reading the size of the file */
-            else if ((state >= 1) && (state <= sizeof(uint32_t))) {
+            else if ((state >= 1) && (state < STATE_DATA)) {
                 state++;
                 data_read.push_back(buf[i]);
                 /* If all sizeof(uint32_t) bytes read  */
-                if (state == (sizeof(uint32_t) + 1)) {
+                if (state == STATE_DATA) {
                     /* Save the file size */
                     memcpy(&file_size, data_read.data(), sizeof(uint32_t));
                     file_size = ntohl(file_size);
@@ -170,12 +208,22 @@ int main(int argc, char* argv[]) {
                     }
                     /* Erase data read */
                     data_read.erase();
+                    /* With checksums, the data comes in blocks and an empty file only has its checksum */
+                    if (checksums) {
+                        block_length = block_remaining = file_size < block_size ? file_size : block_size;
+                        if (file_size == 0) {
+                            state = STATE_FILE_CRC;
+                        }
+                    }
                 }
             }
             /* If reading the third part of the message (file data) add it to the file in chunks (not byte by byte) */
-            else {
-                /* Write filesize bytes, or as many were read if less */
+            else if (state == STATE_DATA) {
+                /* Write filesize bytes (or what's left of the block), or as many were read if less */
                 int to_write = (nread - i) < file_size ? nread - i : file_size;
+                if (checksums && (block_remaining < to_write)) {
+                    to_write = block_remaining;
+                }
                 if (safe_write_bytes(fd, buf + i, to_write) < 0) {
                     perror("remoteClient: write to file");
                     close_report(fd);
@@ -186,8 +234,64 @@ int main(int argc, char* argv[]) {
                 i += to_write - 1;
                 /* Update remaining file bytes */
                 file_size -= to_write;
+                /* If verifying, update the block's checksum and check it when the block is done */
+                if (checksums) {
+                    block_crc = crc32c(block_crc, buf + i + 1 - to_write, to_write);
+                    block_remaining -= to_write;
+                    if (block_remaining == 0) {
+                        state = STATE_BLOCK_CRC;
+                    }
+                }
                 /* If file done, move to the next message */
-                if (file_size == 0) {
+                else if (file_size == 0) {
+                    close_report(fd);
+                    state = 0;
+                }
+            }
+            /* If reading a 4-byte value following the data (checksums) or preceding it (block size) */
+            else {
+                data_read.push_back(buf[i]);
+                if (data_read.size() < sizeof(uint32_t)) {
+                    continue;
+                }
+                uint32_t value;
+                memcpy(&value, data_read.data(), sizeof(uint32_t));
+                value = ntohl(value);
+                data_read.erase();
+                /* Start reading messages after getting the block size */
+                if (state == STATE_BLOCK_SIZE) {
+                    block_size = value;
+                    if (block_size == 0) {
+                        fprintf(stderr, "remoteClient: invalid block size\n");
+                        close_report(sock);
+                        exit(EXIT_FAILURE);
+                    }
+                    crc32c_shift_init(block_shift, block_size);
+                    state = 0;
+                }
+                /* Verify the block, then move to the next block or to the file's checksum */
+                else if (state == STATE_BLOCK_CRC) {
+                    if (value != block_crc) {
+                        fprintf(stderr, "remoteClient: checksum mismatch in %s\n", file_name.data());
+                        close_report(fd);
+                        close_report(sock);
+                        exit(EXIT_FAILURE);
+                    }
+                    /* The file's checksum is made from the blocks' checksums, so the data is only gone through once */
+                    file_crc = (block_length == block_size) ? crc32c_combine(file_crc, block_crc, block_shift) : crc32c_combine(file_crc, block_crc, (size_t) block_length);
+                    block_crc = 0;
+                    block_length = block_remaining = file_size < block_size ? file_size : block_size;
+                    state = (file_size == 0) ? STATE_FILE_CRC : STATE_DATA;
+                }
+                /* Verify the whole file and move to the next message */
+                else {
+                    if (value != file_crc) {
+                        fprintf(stderr, "remoteClient: file checksum mismatch in %s\n", file_name.data());
+                        close_report(fd);
+                        close_report(sock);
+                        exit(EXIT_FAILURE);
+                    }
+                    file_crc = 0;
                     close_report(fd);
                     state = 0;
                 }
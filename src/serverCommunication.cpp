@@ -7,71 +7,75 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <string>
+#include <fcntl.h>
+#include <stdint.h>
 #include "serverCommunication.h"
 #include "serverTypes.h"
 #include "commonFuncs.h"
+#include "checksum.h"
+#include "arena.h"
+#include "namePool.h"
+#include "serverIndex.h"
 
+extern int block_size;  // size of the blocks in which the file contents are transfered to the client in bytes
 extern int queue_size;  // maximum size of the tasks queue
 
 extern std::queue<task> *tasks; // queue containing all current tasks
 
 /* Variables for synchronisation */
 extern pthread_mutex_t queue_lock;
-extern pthread_cond_t cond_nonempty, cond_nonfull, cond_done;
+extern pthread_cond_t cond_nonempty, cond_nonfull;
 
-/* Initialises a sock_info_t variable referring to the socket specified by void_t_socket_id */
-int initialise_sock_info(sock_info_t &sock_info, void *void_t_socket_id) {
+/* Initialises a sock_info_t variable referring to the socket specified by socket_id */
+void initialise_sock_info(sock_info_t &sock_info, int socket_id) {
+    sock_info.sock_id = socket_id;
 
-    /* Save socket id and free the argument */
-    sock_info.sock_id = *(int*) void_t_socket_id;
-    free(void_t_socket_id);
+    /* Initialise socket-specific synchronisation variables */
+    pthread_mutex_init(&sock_info.lock_data_transfer, 0);
+    pthread_mutex_init(&sock_info.lock_tasks_remaining, 0);
+    pthread_cond_init(&sock_info.cond_done, 0);
 
-    /* Create socket-specific mutexes */
-    if ((sock_info.lock_data_transfer = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t))) == NULL) {
-        perror("dataServer: malloc");
-        close_report(sock_info.sock_id);
-        return -1;
-    }
-    pthread_mutex_init(sock_info.lock_data_transfer, 0);
-    if ((sock_info.lock_tasks_remaining = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t))) == NULL) {
-        perror("dataServer: malloc");
-        free(sock_info.lock_data_transfer);
-        close_report(sock_info.sock_id);
-        return -1;
-    }
-    pthread_mutex_init(sock_info.lock_tasks_remaining, 0);
-
-    /* Create counter for remaining tasks */
-    if ((sock_info.tasks_remaining = (int *) malloc(sizeof(int))) == NULL) {
-        perror("dataServer: malloc");
-        free(sock_info.lock_data_transfer);
-        free(sock_info.lock_tasks_remaining);
-        close_report(sock_info.sock_id);
-        return -1;
-        pthread_exit(NULL);
-    }
-    *sock_info.tasks_remaining = 0;
+    /* Initialise counter for remaining tasks */
+    sock_info.tasks_remaining = 0;
 
-    return 0;
+    sock_info.relative_path_size = 0;
+    sock_info.checksums = 0;
 }
 
-/* Frees all data in the sock_info struct and closes the socket */
-void free_socket(sock_info_t sock_info) {
-    free(sock_info.lock_data_transfer);
-    free(sock_info.lock_tasks_remaining);
-    free(sock_info.tasks_remaining);
+/* Destroys all data in the sock_info struct and closes the socket */
+void free_socket(sock_info_t &sock_info) {
+    pthread_mutex_destroy(&sock_info.lock_data_transfer);
+    pthread_mutex_destroy(&sock_info.lock_tasks_remaining);
+    pthread_cond_destroy(&sock_info.cond_done);
     close_report(sock_info.sock_id);
 }
 
-/* Recursively traverses the directory in path, creating a file transfer task bound for sock_info for each file, and put the task in the queue  */
-int traverse_directory(std::string path, sock_info_t sock_info, int relative_path_size) {
+/* Adds new_task to the socket's remaining tasks and puts it in the queue, waiting until there's space */
+void add_task(task new_task) {
+    /* Increment remaining tasks */
+    pthread_mutex_lock(&new_task.sock_info->lock_tasks_remaining);
+    new_task.sock_info->tasks_remaining++;
+    pthread_mutex_unlock(&new_task.sock_info->lock_tasks_remaining);
+
+    /* Push it to the queue when there's space */
+    pthread_mutex_lock(&queue_lock);
+    while (tasks->size() >= queue_size) {
+        pthread_cond_wait(&cond_nonfull, &queue_lock);
+    }
+    tasks->push(new_task);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_cond_signal(&cond_nonempty);
+}
+
+/* Recursively traverses the directory dir opened in dir_fd, creating a file transfer task bound for sock_info for each file, and put the task in the queue.
+   Directory nodes are allocated from arena and file names are copied to slots of the name pool, which the workers give back,
+   so that the memory of a request grows with its directories but not with its files. The directory is closed in the end */
+int traverse_directory(int dir_fd, dir_node_t *dir, sock_info_t *sock_info, arena_t &arena) {
     /* Open the directory */
     DIR *cur_dir;
-    if ((cur_dir = opendir(path.data())) == NULL) {
+    if ((cur_dir = fdopendir(dir_fd)) == NULL) {
         perror("dataServer: opendir");
-        if (errno == EACCES) {
-            return 0;
-        }
+        close_report(dir_fd);
         return -1;
     }
 
@@ -83,41 +87,53 @@ int traverse_directory(std::string path, sock_info_t sock_info, int relative_pat
             continue;
         }
 
-        /* Check what the file is */
-        std::string cur_path = path + "/" + cur_file->d_name;
+        /* Check what the file is (relative to the directory, to avoid building its path) */
         struct stat stat_buf;
-        if (stat(cur_path.data(), &stat_buf) < 0) {
+        if (fstatat(dirfd(cur_dir), cur_file->d_name, &stat_buf, 0) < 0) {
             perror("dataServer: stat");
+            closedir_report(cur_dir);
             return -1;
         }
 
         /* If it is a regular file, make a task for it and put it in the queue */
         if ((stat_buf.st_mode & S_IFMT) == S_IFREG) {
-            /* Increment remaining tasks */
-            pthread_mutex_lock(sock_info.lock_tasks_remaining);
-            (*sock_info.tasks_remaining)++;
-            pthread_mutex_unlock(sock_info.lock_tasks_remaining);
-
             /* Make new task */
             task new_task;
-            new_task.path = cur_path;
-            new_task.relative_path_size = relative_path_size;
+            if ((new_task.name = name_pool_copy(cur_file->d_name)) == NULL) {
+                perror("dataServer: malloc");
+                closedir_report(cur_dir);
+                return -1;
+            }
+            new_task.pooled_name = 1;
+            new_task.dir = dir;
             new_task.file_size = htonl(stat_buf.st_size);
             new_task.sock_info = sock_info;
-
-            /* Push it to the queue when there's space */
-            pthread_mutex_lock(&queue_lock);
-            while (tasks->size() >= queue_size) {
-                pthread_cond_wait(&cond_nonfull, &queue_lock);
-            }
-            tasks->push(new_task);
-            pthread_mutex_unlock(&queue_lock);
-            pthread_cond_signal(&cond_nonempty);
+            add_task(new_task);
         }
 
         /* If it is a directory, recursively call yourself on it */
         else if ((stat_buf.st_mode & S_IFMT) == S_IFDIR) {
-            if (traverse_directory(cur_path, sock_info, relative_path_size) == -1) {
+            int sub_fd;
+            if ((sub_fd = openat(dirfd(cur_dir), cur_file->d_name, O_RDONLY | O_DIRECTORY)) < 0) {
+                int open_errno = errno; // perror may change errno
+                perror("dataServer: opendir");
+                if (open_errno == EACCES) {
+                    continue;
+                }
+                closedir_report(cur_dir);
+                return -1;
+            }
+            dir_node_t *sub_dir;
+            if (((sub_dir = (dir_node_t *) arena_alloc(arena, sizeof(dir_node_t))) == NULL) ||
+                ((sub_dir->name = arena_strdup(arena, cur_file->d_name)) == NULL)) {
+                perror("dataServer: malloc");
+                close_report(sub_fd);
+                closedir_report(cur_dir);
+                return -1;
+            }
+            sub_dir->parent = dir;
+            if (traverse_directory(sub_fd, sub_dir, sock_info, arena) == -1) {
+                closedir_report(cur_dir);
                 return -1;
             }
         }
@@ -125,7 +141,76 @@ int traverse_directory(std::string path, sock_info_t sock_info, int relative_pat
     }
 
     /* Close the directory */
-    closedir(cur_dir);
+    closedir_report(cur_dir);
+
+    /* Return successfully */
+    return 0;
+}
+
+/* Recursively goes through the directory dir opened in dir_fd, which is at position pos in index, creating a file transfer task bound for sock_info
+   for each file, and put the task in the queue. File and directory names point into the index and directory nodes are allocated from arena.
+   A directory whose modification time differs from the one in the index has gained or lost entries since it was indexed,
+   so it is traversed in the file system instead. The directory is closed in the end */
+int traverse_index(const tree_index_t *index, uint64_t pos, int dir_fd, dir_node_t *dir, sock_info_t *sock_info, arena_t &arena) {
+    /* Check that the directory's entries are still the indexed ones */
+    struct stat stat_buf;
+    if (fstat(dir_fd, &stat_buf) < 0) {
+        perror("dataServer: stat");
+        close_report(dir_fd);
+        return -1;
+    }
+    if (stat_mtime(stat_buf) != index->nodes[pos].mtime) {
+        return traverse_directory(dir_fd, dir, sock_info, arena);
+    }
+
+    /* For each entry in the directory (the entries of its subtree are contiguous in depth-first order) */
+    uint64_t end = pos + index->nodes[pos].subtree_size;
+    for (uint64_t i = pos + 1 ; i < end ; i += index->nodes[i].subtree_size) {
+        const index_node_t &node = index->nodes[i];
+        const char *name = index->names + node.name_offset;
+
+        /* If it is a regular file, make a task for it and put it in the queue */
+        if (node.type == INDEX_FILE) {
+            task new_task;
+            new_task.dir = dir;
+            new_task.name = name;
+            new_task.pooled_name = 0;
+            new_task.file_size = htonl(node.size);
+            new_task.sock_info = sock_info;
+            add_task(new_task);
+        }
+
+        /* If it is a directory, recursively call yourself on it */
+        else {
+            int sub_fd;
+            if ((sub_fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY)) < 0) {
+                int open_errno = errno; // perror may change errno
+                perror("dataServer: opendir");
+                /* Directories that can't be read, or were removed since they were indexed, are skipped */
+                if ((open_errno == EACCES) || (open_errno == ENOENT) || (open_errno == ENOTDIR)) {
+                    continue;
+                }
+                close_report(dir_fd);
+                return -1;
+            }
+            dir_node_t *sub_dir;
+            if ((sub_dir = (dir_node_t *) arena_alloc(arena, sizeof(dir_node_t))) == NULL) {
+                perror("dataServer: malloc");
+                close_report(sub_fd);
+                close_report(dir_fd);
+                return -1;
+            }
+            sub_dir->parent = dir;
+            sub_dir->name = name;
+            if (traverse_index(index, i, sub_fd, sub_dir, sock_info, arena) == -1) {
+                close_report(dir_fd);
+                return -1;
+            }
+        }
+    }
+
+    /* Close the directory */
+    close_report(dir_fd);
 
     /* Return successfully */
     return 0;
@@ -136,19 +221,29 @@ void *communication_thread(void *void_t_socket_id) {
 
     /* Initialise info about the socket */
     sock_info_t sock_info;
-    if (initialise_sock_info(sock_info, void_t_socket_id) != 0) {
-        pthread_exit(NULL);
-    }
+    initialise_sock_info(sock_info, (int) (intptr_t) void_t_socket_id);
     
     /* Read path from client */
     int nread;
     char buf[50];
     int i;
-    int relative_path_size = 0; // size of the relative path. without the final directory
     std::string path;           // path requested by client
+    int received = 0;           // bytes of the request processed so far
+    char options = 0;           // options byte of the request, if any
+    char read_options = 0;      // whether the next byte is the options byte
     while (((nread = read(sock_info.sock_id, buf, 50)) > 0) || (errno == EINTR)) {
         /* After reading a block, process it character by character in memory */
-        for (i = 0 ; i < nread ; i++) {
+        for (i = 0 ; i < nread ; i++, received++) {
+            /* A marker at the start means the options byte comes before the path */
+            if ((received == 0) && (buf[i] == OPTIONS_MARKER)) {
+                read_options = 1;
+                continue;
+            }
+            if (read_options) {
+                options = buf[i];
+                read_options = 0;
+                continue;
+            }
             /* Nul ends the message */
             if (buf[i] == '\0') {
                 break;
@@ -158,7 +253,7 @@ void *communication_thread(void *void_t_socket_id) {
             /* Check for the final slash to know what part of the request only
             refers to the position of the directory and isn't to be transfered */
             if (buf[i] == '/') {
-                relative_path_size = path.size();
+                sock_info.relative_path_size = path.size();
             }
         }
         /* If break, break */
@@ -179,28 +274,55 @@ void *communication_thread(void *void_t_socket_id) {
         pthread_exit(NULL);
     }
 
+    sock_info.checksums = options & OPTION_CHECKSUMS;
+
+    /* If checksums were asked for, tell the client the block size, since a checksum follows every block */
+    if (sock_info.checksums) {
+        uint32_t net_block_size = htonl(block_size);
+        if (safe_write_bytes(sock_info.sock_id, (const char *) &net_block_size, sizeof(uint32_t)) < 0) {
+            perror("dataServer: write to socket");
+            free_socket(sock_info);
+            pthread_exit(NULL);
+        }
+    }
+
+    /* Tasks refer to the directory tree and file names kept in this thread's arena */
+    arena_t arena;
+    arena_init(arena);
+    dir_node_t root;
+    root.parent = NULL;
+    root.name = path.data();
+
     /* Check if directory exists and is accessible */
-    DIR *requested_dir;
-    struct stat stat_buf;
-    if ((requested_dir = opendir(path.data())) == NULL) {
+    int requested_dir;
+    if ((requested_dir = open(path.data(), O_RDONLY | O_DIRECTORY)) < 0) {
         perror("dataServer: opendir");
         free_socket(sock_info);
         pthread_exit(NULL);
     }
-    closedir_report(requested_dir);
 
-    /* Traverse directory adding all files to tasks queue */
-    if (traverse_directory(path, sock_info, relative_path_size) != 0) {
+    /* If the directory is in the index, add all files to tasks queue from the index, only walking the file system where it changed,
+       else traverse directory adding all files to tasks queue */
+    tree_index_t *index = index_acquire();
+    int64_t index_pos = (index != NULL) ? index_find(index, path.data()) : -1;
+    if (((index_pos >= 0) ? traverse_index(index, index_pos, requested_dir, &root, &sock_info, arena) :
+                            traverse_directory(requested_dir, &root, &sock_info, arena)) != 0) {
         free_socket(sock_info);
         exit(EXIT_FAILURE);
     }
 
     /* Wait for all tasks to end */
-    pthread_mutex_lock(sock_info.lock_tasks_remaining);
-    while ((*sock_info.tasks_remaining) > 0) {
-        pthread_cond_wait(&cond_done, sock_info.lock_tasks_remaining);
+    pthread_mutex_lock(&sock_info.lock_tasks_remaining);
+    while (sock_info.tasks_remaining > 0) {
+        pthread_cond_wait(&sock_info.cond_done, &sock_info.lock_tasks_remaining);
+    }
+    pthread_mutex_unlock(&sock_info.lock_tasks_remaining);
+
+    /* No task refers to the arena or the index anymore */
+    arena_free(arena);
+    if (index != NULL) {
+        index_release(index);
     }
-    pthread_mutex_unlock(sock_info.lock_tasks_remaining);
 
     /* Notify the client that we're done */
     if (safe_write_bytes(sock_info.sock_id, "", 1) < 0) {
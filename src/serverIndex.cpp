@@ -0,0 +1,422 @@
+/* File: serverIndex.cpp */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "serverIndex.h"
+#include "commonFuncs.h"
+
+/* Index currently in use and the files it refers to */
+static tree_index_t *current_index = NULL;
+static std::string index_file;  // path of the index file
+static std::string index_root;  // absolute path of the indexed directory
+
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;  // Mutex guarding current_index and the reference counts
+
+/* State of an index being built */
+typedef struct {
+    std::vector<index_node_t> nodes;    // entries so far
+    std::string names;                  // names so far
+    const tree_index_t *old;            // previous index of the same tree, or NULL
+} index_builder_t;
+
+/* Modification time of a file in nanoseconds, as kept in the index */
+int64_t stat_mtime(const struct stat &stat_buf) {
+    return (int64_t) stat_buf.st_mtim.tv_sec * 1000000000 + stat_buf.st_mtim.tv_nsec;
+}
+
+/* Adds an entry of the given type for the file described by stat_buf to the index being built, returning its position */
+static uint32_t index_add_node(index_builder_t &builder, const char *name, const struct stat &stat_buf, uint32_t type) {
+    index_node_t node;
+    node.size = (type == INDEX_FILE) ? stat_buf.st_size : 0;
+    node.mtime = stat_mtime(stat_buf);
+    node.name_offset = builder.names.size();
+    node.subtree_size = 1;
+    node.type = type;
+    builder.names.append(name);
+    builder.names.push_back('\0');
+    builder.nodes.push_back(node);
+    return builder.nodes.size() - 1;
+}
+
+/* Adds the directory opened in dir_fd, described by stat_buf, and everything under it to the index being built.
+   old_pos is the position of the same directory in the previous index, or -1. If its modification time hasn't changed,
+   its list of entries is taken from the previous index instead of reading the directory again.
+   The directory is closed in the end. Returns 0 in case of success and -1 in case of failure. */
+static int index_add_directory(index_builder_t &builder, int dir_fd, const char *name, const struct stat &stat_buf, int64_t old_pos) {
+    uint32_t pos = index_add_node(builder, name, stat_buf, INDEX_DIR);
+
+    /* Collect the names of the directory's entries, along with their positions in the previous index */
+    std::vector<std::pair<std::string, int64_t> > entries;
+    const tree_index_t *old = builder.old;
+    if ((old_pos >= 0) && (old->nodes[old_pos].mtime == stat_mtime(stat_buf))) {
+        /* Unchanged directory: its children in the previous index */
+        uint64_t end = old_pos + old->nodes[old_pos].subtree_size;
+        for (uint64_t i = old_pos + 1 ; i < end ; i += old->nodes[i].subtree_size) {
+            entries.push_back(std::make_pair(std::string(old->names + old->nodes[i].name_offset), (int64_t) i));
+        }
+    }
+    else {
+        /* Changed or new directory: read it, matching its entries with the previous index by name */
+        std::unordered_map<std::string, int64_t> old_children;
+        if (old_pos >= 0) {
+            uint64_t end = old_pos + old->nodes[old_pos].subtree_size;
+            for (uint64_t i = old_pos + 1 ; i < end ; i += old->nodes[i].subtree_size) {
+                old_children[old->names + old->nodes[i].name_offset] = i;
+            }
+        }
+        DIR *dir;
+        if ((dir = fdopendir(dir_fd)) == NULL) {
+            perror("dataServer: index opendir");
+            close_report(dir_fd);
+            return -1;
+        }
+        dir_fd = dup(dirfd(dir));
+        struct dirent *cur_file;
+        while ((cur_file = readdir(dir)) != NULL) {
+            if ((cur_file->d_ino == 0) || !strcmp(cur_file->d_name, ".") || !strcmp(cur_file->d_name, "..")) {
+                continue;
+            }
+            std::unordered_map<std::string, int64_t>::iterator old_child = old_children.find(cur_file->d_name);
+            entries.push_back(std::make_pair(std::string(cur_file->d_name), old_child == old_children.end() ? -1 : old_child->second));
+        }
+        closedir_report(dir);
+        if (dir_fd < 0) {
+            perror("dataServer: index dup");
+            return -1;
+        }
+    }
+
+    /* Add each regular file and directory (everything else is ignored, like in a transfer) */
+    for (size_t i = 0 ; i < entries.size() ; i++) {
+        const char *entry_name = entries[i].first.data();
+        struct stat entry_stat;
+        /* Entries removed in the meantime are skipped */
+        if (fstatat(dir_fd, entry_name, &entry_stat, 0) < 0) {
+            if (errno == ENOENT) {
+                continue;
+            }
+            perror("dataServer: index stat");
+            close_report(dir_fd);
+            return -1;
+        }
+        if ((entry_stat.st_mode & S_IFMT) == S_IFREG) {
+            index_add_node(builder, entry_name, entry_stat, INDEX_FILE);
+        }
+        else if ((entry_stat.st_mode & S_IFMT) == S_IFDIR) {
+            /* Directories that can't be read are skipped */
+            int sub_fd;
+            if ((sub_fd = openat(dir_fd, entry_name, O_RDONLY | O_DIRECTORY)) < 0) {
+                if ((errno == EACCES) || (errno == ENOENT)) {
+                    continue;
+                }
+                perror("dataServer: index opendir");
+                close_report(dir_fd);
+                return -1;
+            }
+            int64_t old_child = entries[i].second;
+            if ((old_child >= 0) && (old->nodes[old_child].type != INDEX_DIR)) {
+                old_child = -1;
+            }
+            if (index_add_directory(builder, sub_fd, entry_name, entry_stat, old_child) != 0) {
+                close_report(dir_fd);
+                return -1;
+            }
+        }
+    }
+    close_report(dir_fd);
+
+    /* The subtree ends here */
+    builder.nodes[pos].subtree_size = builder.nodes.size() - pos;
+    return 0;
+}
+
+/* Builds the index of index_root and writes it to index_file, replacing the previous file atomically.
+   old is the previous index of the same tree, or NULL. Returns 0 if the index was written,
+   1 if it is the same as old (so nothing was written) and -1 in case of failure. */
+static int index_build(const tree_index_t *old) {
+    /* Index the tree, reserving the previous index's size so that the entries aren't copied while growing */
+    index_builder_t builder;
+    builder.old = old;
+    if (old != NULL) {
+        builder.nodes.reserve(old->node_count);
+        builder.names.reserve(old->names_size);
+    }
+    int root_fd;
+    struct stat root_stat;
+    if ((root_fd = open(index_root.data(), O_RDONLY | O_DIRECTORY)) < 0) {
+        perror("dataServer: index opendir");
+        return -1;
+    }
+    if (fstat(root_fd, &root_stat) < 0) {
+        perror("dataServer: index stat");
+        close_report(root_fd);
+        return -1;
+    }
+    if (index_add_directory(builder, root_fd, index_root.data(), root_stat, old ? 0 : -1) != 0) {
+        return -1;
+    }
+
+    /* If nothing changed, keep the previous file */
+    if ((old != NULL) && (builder.nodes.size() == old->node_count) && (builder.names.size() == old->names_size) &&
+        !memcmp(builder.nodes.data(), old->nodes, builder.nodes.size() * sizeof(index_node_t)) &&
+        !memcmp(builder.names.data(), old->names, builder.names.size())) {
+        return 1;
+    }
+
+    /* Write it to a temporary file */
+    index_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.node_count = builder.nodes.size();
+    header.names_size = builder.names.size();
+    std::string tmp_file = index_file + ".tmp";
+    int fd;
+    if ((fd = open(tmp_file.data(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        perror("dataServer: index create file");
+        return -1;
+    }
+    if ((safe_write_bytes(fd, (const char *) &header, sizeof(header)) < 0) ||
+        (safe_write_bytes(fd, (const char *) builder.nodes.data(), builder.nodes.size() * sizeof(index_node_t)) < 0) ||
+        (safe_write_bytes(fd, builder.names.data(), builder.names.size()) < 0) ||
+        (fsync(fd) < 0)) {
+        perror("dataServer: index write file");
+        close_report(fd);
+        unlink(tmp_file.data());
+        return -1;
+    }
+    close_report(fd);
+
+    /* Put it in place of the previous one (which stays valid for whoever has it mapped) */
+    if (rename(tmp_file.data(), index_file.data()) < 0) {
+        perror("dataServer: index rename file");
+        unlink(tmp_file.data());
+        return -1;
+    }
+    return 0;
+}
+
+/* Checks that every entry of an index is consistent, so that it can be used without further checks.
+   Returns 0 if it is and -1 if it isn't */
+static int index_validate(const index_node_t *nodes, uint32_t node_count, uint64_t names_size) {
+    /* Positions where the subtrees of the directories containing the current entry end */
+    std::vector<uint64_t> ends;
+    for (uint64_t i = 0 ; i < node_count ; i++) {
+        const index_node_t &node = nodes[i];
+        if ((node.name_offset >= names_size) || ((node.type != INDEX_FILE) && (node.type != INDEX_DIR)) ||
+            (node.subtree_size < 1) || (node.subtree_size > node_count - i) || ((node.type == INDEX_FILE) && (node.subtree_size != 1))) {
+            return -1;
+        }
+        /* Every entry but the first is inside the first one, and every subtree is inside its parent's */
+        while (!ends.empty() && (i >= ends.back())) {
+            ends.pop_back();
+        }
+        if ((i > 0) && (ends.empty() || (i + node.subtree_size > ends.back()))) {
+            return -1;
+        }
+        if (node.type == INDEX_DIR) {
+            ends.push_back(i + node.subtree_size);
+        }
+    }
+    return 0;
+}
+
+/* Maps index_file to memory, checking that it is an index of index_root.
+   Returns the index, or NULL if the file doesn't exist or isn't a valid index of index_root */
+static tree_index_t *index_load() {
+    int fd;
+    if ((fd = open(index_file.data(), O_RDONLY)) < 0) {
+        if (errno != ENOENT) {
+            perror("dataServer: index open file");
+        }
+        return NULL;
+    }
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) < 0) {
+        perror("dataServer: index stat");
+        close_report(fd);
+        return NULL;
+    }
+    if ((size_t) stat_buf.st_size < sizeof(index_header_t)) {
+        close_report(fd);
+        return NULL;
+    }
+    void *map;
+    if ((map = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        perror("dataServer: index mmap");
+        close_report(fd);
+        return NULL;
+    }
+    close_report(fd);
+
+    /* Check that the sizes add up, that every entry is consistent and that the first entry is index_root */
+    const index_header_t *header = (const index_header_t *) map;
+    const index_node_t *nodes = (const index_node_t *) (header + 1);
+    const char *names = (const char *) (nodes + header->node_count);
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) || (header->version != INDEX_VERSION) || (header->node_count == 0) ||
+        (header->names_size == 0) || (header->names_size > (uint64_t) stat_buf.st_size) ||
+        ((uint64_t) stat_buf.st_size != sizeof(index_header_t) + header->node_count * sizeof(index_node_t) + header->names_size) ||
+        (names[header->names_size - 1] != '\0') || (index_validate(nodes, header->node_count, header->names_size) != 0) ||
+        (nodes[0].type != INDEX_DIR) || (nodes[0].subtree_size != header->node_count) || strcmp(names + nodes[0].name_offset, index_root.data())) {
+        fprintf(stderr, "dataServer: %s is not a valid index of %s\n", index_file.data(), index_root.data());
+        munmap(map, stat_buf.st_size);
+        return NULL;
+    }
+
+    /* Make the index */
+    tree_index_t *index = new tree_index_t;
+    index->map = map;
+    index->map_size = stat_buf.st_size;
+    index->nodes = nodes;
+    index->node_count = header->node_count;
+    index->names = names;
+    index->names_size = header->names_size;
+    index->refs = 1;
+    return index;
+}
+
+/* Makes index the current index, giving back the previous one */
+static void index_install(tree_index_t *index) {
+    pthread_mutex_lock(&index_lock);
+    tree_index_t *old = current_index;
+    current_index = index;
+    pthread_mutex_unlock(&index_lock);
+    if (old != NULL) {
+        index_release(old);
+    }
+}
+
+/* Loads the index of the directory tree in root from index_path, building it if it doesn't exist or is for another directory.
+   Returns 0 in case of success and -1 in case of failure. */
+int index_init(const char *index_path, const char *root) {
+    char real_root[PATH_MAX];
+    if (realpath(root, real_root) == NULL) {
+        perror("dataServer: index realpath");
+        return -1;
+    }
+    index_file = index_path;
+    index_root = real_root;
+
+    /* Use the existing index if there is one, else build it */
+    tree_index_t *index;
+    if ((index = index_load()) == NULL) {
+        printf("Building index of %s...\n", real_root);
+        if ((index_build(NULL) == -1) || ((index = index_load()) == NULL)) {
+            return -1;
+        }
+    }
+    index_install(index);
+    printf("Index of %s loaded (%u entries)\n", real_root, index->node_count);
+    return 0;
+}
+
+/* Returns the current index, which must be given back with index_release, or NULL if there is none */
+tree_index_t *index_acquire() {
+    pthread_mutex_lock(&index_lock);
+    tree_index_t *index = current_index;
+    if (index != NULL) {
+        index->refs++;
+    }
+    pthread_mutex_unlock(&index_lock);
+    return index;
+}
+
+/* Gives back an index returned by index_acquire */
+void index_release(tree_index_t *index) {
+    pthread_mutex_lock(&index_lock);
+    int refs = --index->refs;
+    pthread_mutex_unlock(&index_lock);
+    /* Unmap it once nobody uses it */
+    if (refs == 0) {
+        munmap(index->map, index->map_size);
+        delete index;
+    }
+}
+
+/* Returns the position in index of the directory in path, or -1 if it isn't in the index */
+int64_t index_find(const tree_index_t *index, const char *path) {
+    /* Only directories under the indexed one can be found */
+    char real_path[PATH_MAX];
+    if (realpath(path, real_path) == NULL) {
+        return -1;
+    }
+    size_t root_size = index_root.size();
+    if (strncmp(real_path, index_root.data(), root_size) ||
+        ((real_path[root_size] != '/') && (real_path[root_size] != '\0') && (index_root != "/"))) {
+        return -1;
+    }
+
+    /* Follow each component of the rest of the path down from the root */
+    uint64_t pos = 0;
+    char *component = real_path + root_size;
+    while (*component != '\0') {
+        /* Get the next component */
+        while (*component == '/') {
+            component++;
+        }
+        if (*component == '\0') {
+            break;
+        }
+        char *component_end = component;
+        while ((*component_end != '/') && (*component_end != '\0')) {
+            component_end++;
+        }
+        char next = *component_end;
+        *component_end = '\0';
+
+        /* Find it among the children of the current directory */
+        uint64_t end = pos + index->nodes[pos].subtree_size;
+        uint64_t i;
+        for (i = pos + 1 ; i < end ; i += index->nodes[i].subtree_size) {
+            if (!strcmp(index->names + index->nodes[i].name_offset, component)) {
+                break;
+            }
+        }
+        if ((i >= end) || (index->nodes[i].type != INDEX_DIR)) {
+            return -1;
+        }
+        pos = i;
+
+        *component_end = next;
+        component = component_end;
+    }
+    return pos;
+}
+
+/* Function to be executed by the index refresh thread, rebuilding the index every (intptr_t) void_t_interval seconds */
+void *index_refresh_thread(void *void_t_interval) {
+    unsigned int interval = (unsigned int) (intptr_t) void_t_interval;
+
+    /* Main refresh loop */
+    while (1) {
+        sleep(interval);
+
+        /* Rebuild the index from the current one, keeping the current one if nothing changed or anything goes wrong */
+        tree_index_t *old = index_acquire();
+        int result = index_build(old);
+        if (old != NULL) {
+            index_release(old);
+        }
+        if (result == 1) {
+            continue;
+        }
+        tree_index_t *index;
+        if ((result != 0) || ((index = index_load()) == NULL)) {
+            fprintf(stderr, "dataServer: index refresh failed\n");
+            continue;
+        }
+        index_install(index);
+    }
+}
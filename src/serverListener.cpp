@@ -0,0 +1,56 @@
+/* File: serverListener.cpp */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "serverListener.h"
+#include "serverCommunication.h"
+#include "commonFuncs.h"
+
+#define ACCEPT_RETRY_DELAY 10000    // microseconds to wait before accepting again when out of resources
+
+/* Function to be executed by listener threads, accepting connections on the listening socket in void_t_socket and creating a communication thread for each */
+void *listener_thread(void *void_t_socket) {
+    int sock = (int) (intptr_t) void_t_socket;
+
+    /* Main listener loop */
+    while (1) {
+        int newsock;
+        struct sockaddr_in client;
+        socklen_t clientlen = sizeof(client);
+        /* Accept connection */
+        if ((newsock = accept(sock, (sockaddr*) &client, &clientlen)) < 0) {
+            int accept_errno = errno;   // perror may change errno
+            perror("dataServer: accept connection");
+            /* Errors of a single connection (aborted, or network errors passed on by accept), just go on to the next one */
+            if ((accept_errno == EINTR) || (accept_errno == ECONNABORTED) || (accept_errno == EPROTO) || (accept_errno == EPERM) ||
+                (accept_errno == ENETDOWN) || (accept_errno == ENOPROTOOPT) || (accept_errno == EHOSTDOWN) || (accept_errno == ENONET) ||
+                (accept_errno == EHOSTUNREACH) || (accept_errno == EOPNOTSUPP) || (accept_errno == ENETUNREACH)) {
+                continue;
+            }
+            /* Out of file descriptors or memory, wait a bit for some to be freed instead of retrying the pending connection right away */
+            if ((accept_errno == EMFILE) || (accept_errno == ENFILE) || (accept_errno == ENOBUFS) || (accept_errno == ENOMEM)) {
+                usleep(ACCEPT_RETRY_DELAY);
+                continue;
+            }
+            /* Anything else means the listening socket itself is broken */
+            close_report(sock);
+            exit(EXIT_FAILURE);
+        }
+        /* Create communication thread for this client, passing the socket id in the argument itself */
+        pthread_t com_thread_id;
+        if (pthread_create(&com_thread_id, NULL, communication_thread, (void *) (intptr_t) newsock) != 0) {
+            perror("dataServer: create communication thread");
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_detach(com_thread_id) != 0) {
+            perror("dataServer: detach communication thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
@@ -1,38 +1,60 @@
 /* File: serverWorker.cpp */
 
+#include <stdio.h>
 #include <string>
 #include <queue>
 #include <unistd.h>
 #include <fcntl.h>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include "serverWorker.h"
 #include "commonFuncs.h"
 #include "serverTypes.h"
+#include "checksum.h"
+#include "namePool.h"
 
 extern int block_size;  // size of the blocks in which the file contents are transfered to the client in bytes
+extern crc32c_shift_t block_shift;  // appending of a block to a checksum
 
 extern std::queue<task> *tasks; // queue containing all current tasks
 
 /* Variables for synchronisation */
 extern pthread_mutex_t queue_lock;
-extern pthread_cond_t cond_nonempty, cond_nonfull, cond_done;
+extern pthread_cond_t cond_nonempty, cond_nonfull;
 
 /* Bookkeeping after finishing  current_task */
 void finish_task(task current_task) {
+    /* Give back the copy of the file's name, if any */
+    if (current_task.pooled_name) {
+        name_pool_release((char *) current_task.name);
+    }
+
     /* Unlock the socket's transfer mutex so that another thread can start writing to it */
-    pthread_mutex_unlock(current_task.sock_info.lock_data_transfer);
+    pthread_mutex_unlock(&current_task.sock_info->lock_data_transfer);
 
-    /* Decrement the number of remaining tasks for the socket */
-    pthread_mutex_lock(current_task.sock_info.lock_tasks_remaining);
-    (*current_task.sock_info.tasks_remaining)--;
-    pthread_mutex_unlock(current_task.sock_info.lock_tasks_remaining);
+    /* Decrement the number of remaining tasks for the socket and notify its communication thread.
+       Signal before unlocking, since the communication thread frees sock_info once there are no tasks left */
+    pthread_mutex_lock(&current_task.sock_info->lock_tasks_remaining);
+    current_task.sock_info->tasks_remaining--;
+    pthread_cond_signal(&current_task.sock_info->cond_done);
+    pthread_mutex_unlock(&current_task.sock_info->lock_tasks_remaining);
+}
 
-    /* Notify communication thread that a task was finished */
-    pthread_cond_signal(&cond_done);
+/* Appends the path of directory dir to path, followed by a slash */
+void append_dir_path(std::string &path, const dir_node_t *dir) {
+    if (dir->parent != NULL) {
+        append_dir_path(path, dir->parent);
+    }
+    path.append(dir->name);
+    path.push_back('/');
 }
 
 /* Function to be executed by worker threads, doing file transfers found in the tasks queue */
 void *worker_thread(void *arg) {
     task current_task;
+    std::string path;   // path of the current file, reusing its memory across tasks
 
     /* Main worker loop */
     while (1) {
@@ -48,49 +70,119 @@ void *worker_thread(void *arg) {
 
         /* Do task */
 
-        pthread_mutex_lock(current_task.sock_info.lock_data_transfer);
+        pthread_mutex_lock(&current_task.sock_info->lock_data_transfer);
+        /* Build the file's path from its directory and name */
+        path.clear();
+        append_dir_path(path, current_task.dir);
+        path.append(current_task.name);
+
         /* Open the file */
         int fd;
-        if ((fd = open(current_task.path.data(), O_RDONLY)) < 0) {
+        if ((fd = open(path.data(), O_RDONLY)) < 0) {
+            int open_errno = errno; // perror may change errno
             perror("dataServer: open file");
-            /* If there are no permissions on this file, just skip it */
-            if (errno == EACCES) {
+            /* If there are no permissions on this file, or it was removed since it was indexed, just skip it */
+            if ((open_errno == EACCES) || (open_errno == ENOENT)) {
                 finish_task(current_task);
                 continue;
             }
-            close_report(current_task.sock_info.sock_id);
+            close_report(current_task.sock_info->sock_id);
             exit(EXIT_FAILURE);
         }
 
+        /* Announce the file's current size (the size in the task, e.g. from the index, may be outdated) */
+        struct stat stat_buf;
+        if (fstat(fd, &stat_buf) < 0) {
+            perror("dataServer: stat");
+            close_report(current_task.sock_info->sock_id);
+            exit(EXIT_FAILURE);
+        }
+        /* The protocol can't announce a size that doesn't fit in a uint32_t, so abort the connection instead of sending a truncated copy */
+        if (stat_buf.st_size > UINT32_MAX) {
+            fprintf(stderr, "dataServer: %s is too large to send (%lld bytes), aborting connection\n", path.data(), (long long) stat_buf.st_size);
+            shutdown(current_task.sock_info->sock_id, SHUT_RDWR);
+            close_report(fd);
+            finish_task(current_task);
+            continue;
+        }
+        current_task.file_size = htonl(stat_buf.st_size);
+
         /* Add the file's size after the name */
-        current_task.path.erase(0, current_task.relative_path_size);
-        current_task.path.push_back('\0');
-        current_task.path.append((const char *) &(current_task.file_size), sizeof(uint32_t));
+        path.push_back('\0');
+        path.append((const char *) &(current_task.file_size), sizeof(uint32_t));
 
-        /* Send the name and the size to the client */
-        if (safe_write_bytes(current_task.sock_info.sock_id, current_task.path.data(), current_task.path.size()) < 0) {
+        /* Send the name (without the relative part) and the size to the client */
+        int relative_path_size = current_task.sock_info->relative_path_size;
+        if (safe_write_bytes(current_task.sock_info->sock_id, path.data() + relative_path_size, path.size() - relative_path_size) < 0) {
             perror("dataServer: write to socket");
             close_report(fd);
             finish_task(current_task);
             continue;
         }
         
-        /* Send the file contents to the client in block_size blocks */
-        char buf[block_size];
-        int nread;
-        while ((nread = read(fd, buf, block_size)) > 0) {
-            if (safe_write_bytes(current_task.sock_info.sock_id, buf, nread) < 0) {
-                perror("dataServer: write to socket");
-                close_report(fd);
-                finish_task(current_task);
-                continue;
+        /* Send the file contents to the client in block_size blocks, each followed by its checksum if asked for.
+           Exactly the announced size is sent, so if the file grows while being sent only its announced part is */
+        char buf[block_size + sizeof(uint32_t)];
+        int nread = 0;
+        char write_failed = 0;
+        char size_changed = 0;
+        uint32_t remaining = ntohl(current_task.file_size);
+        uint32_t file_crc = 0;
+        while (remaining > 0) {
+            int to_read = remaining < block_size ? remaining : block_size;
+            if ((nread = safe_read_bytes(fd, buf, to_read)) < 0) {
+                break;
+            }
+            /* If the file got shorter, the client can't get what was announced (also stops if nothing can be read at all) */
+            if ((nread < to_read) || (nread == 0)) {
+                size_changed = 1;
+                break;
+            }
+            int to_send = nread;
+            if (current_task.sock_info->checksums) {
+                /* The file's checksum is made from the blocks' checksums, so the data is only gone through once */
+                uint32_t block_crc = crc32c(0, buf, nread);
+                file_crc = (nread == block_size) ? crc32c_combine(file_crc, block_crc, block_shift) : crc32c_combine(file_crc, block_crc, (size_t) nread);
+                block_crc = htonl(block_crc);
+                memcpy(buf + nread, &block_crc, sizeof(uint32_t));
+                to_send += sizeof(uint32_t);
             }
+            if (safe_write_bytes(current_task.sock_info->sock_id, buf, to_send) < 0) {
+                write_failed = 1;
+                break;
+            }
+            remaining -= nread;
         }
         if (nread < 0) {
             perror("dataServer: read file");
-            close_report(current_task.sock_info.sock_id);
+            close_report(current_task.sock_info->sock_id);
             exit(EXIT_FAILURE);
         }
+        if (write_failed) {
+            perror("dataServer: write to socket");
+            close_report(fd);
+            finish_task(current_task);
+            continue;
+        }
+        /* Abort the connection, so that the client sees the transfer failed instead of getting a wrong file */
+        if (size_changed) {
+            fprintf(stderr, "dataServer: %s got shorter while being sent, aborting connection\n", path.data());
+            shutdown(current_task.sock_info->sock_id, SHUT_RDWR);
+            close_report(fd);
+            finish_task(current_task);
+            continue;
+        }
+
+        /* Send the checksum of the whole file after its contents */
+        if (current_task.sock_info->checksums) {
+            file_crc = htonl(file_crc);
+            if (safe_write_bytes(current_task.sock_info->sock_id, (const char *) &file_crc, sizeof(uint32_t)) < 0) {
+                perror("dataServer: write to socket");
+                close_report(fd);
+                finish_task(current_task);
+                continue;
+            }
+        }
 
         /* Close the file */
         close_report(fd);